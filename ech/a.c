@@ -3,6 +3,7 @@
 #include <time.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <strings.h>
 #include <math.h>
 #include <assert.h>
@@ -13,9 +14,10 @@
 // --- static helper functions should be inlined
 
 static unsigned long long rdtsc (void) {
-  unsigned long long tick;
-  __asm__ __volatile__("rdtsc":"=A"(tick));
-  return tick; }
+  // NB: "=A" only gives us %rax on x86-64, so collect both halves
+  unsigned lo, hi;
+  __asm__ __volatile__("rdtsc":"=a"(lo), "=d"(hi));
+  return (unsigned long long) hi << 32 | lo; }
 
 static uint64_t bits (uint64_t *V, int i, int b) {
   int w0 = i/64, w1 = (i+b-1)/64, ii = i%64;
@@ -41,23 +43,39 @@ static uint64_t dotprod (uint64_t *A, uint64_t *B, int w0, int w1) {
     x ^= A[w] & B[w];
   return __builtin_parityl(x); }
 
+// ----------------------------------------------------------------------
+// 4 Russians table size: each block of S pivots costs a 2^S row table
+// build plus a pass over the rows below, and we need n/S such blocks,
+// so minimise (2^S + m/2) / S -- but keep the table resident in half
+// of the L2 cache as it is read randomly during the reduction.
+
+static int table_bits(const int m, const int wds) {
+  long cache = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  if (cache <= 0) cache = 1L<<18; // not reported? assume 256K
+  int S = 2;
+  while (S < 16 && (2L<<S) * wds * 8 <= cache/2 &&
+         ((2L<<S) + m/2) * S < ((1L<<S) + m/2) * (S+1))
+    S++;
+  return S; }
+
+// cycles spent building 4 Russians tables (reported by the benchmark)
+static uint64_t tm_table;
+
 // ----------------------------------------------------------------------
 // main worker functions
 
 static int semi_ech(const int m, const int n, const int wds, uint64_t (*A)[wds],
-                    int S, int *piv) {
+                    int S, int *piv, uint64_t *work) {
 
   // 4 Russians with S bit tables; Z[] holds the precomputed row sums,
-  // z[] the indexing into Z[] required since we don't reduce above the
-  // block diagonal...
+  // indexed directly by the bits they have in the current block; the
+  // caller may pass (1<<S) * wds words of scratch space for Z[]
 
-  if (S == 0) S = log(m); // reasonable default
+  if (S == 0) S = table_bits(m, wds); // reasonable default
 
   const int SS = (1<<S);
-  uint64_t (*Z)[wds] = malloc(SS * sizeof *Z); // Z[SS][wds]
-  int *z = malloc(SS * sizeof *z);
+  uint64_t (*Z)[wds] = work ? (void *) work : malloc(SS * sizeof *Z); // Z[SS][wds]
   assert(Z);
-  assert(z);
 
   int r = 0; // row in reduction
   int s = 0; // block start for 4 Russians table
@@ -91,7 +109,7 @@ static int semi_ech(const int m, const int n, const int wds, uint64_t (*A)[wds],
 
    */
 
-  for (; S > 1 && s + S <= m && r == s; s += S) {
+  for (; S > 1 && s + S <= m && s + S <= n && r == s; s += S) {
 
     // S columns at a time for 4 Russians method
 
@@ -126,23 +144,27 @@ static int semi_ech(const int m, const int n, const int wds, uint64_t (*A)[wds],
     // this block -- unless there are no rows below us...
     if (s + S == m) break;
 
-    // instead of reducing above the block to compute the Z table,
-    // we'll figure it out using an array of indices...
+    // instead of reducing above the block to compute the Z table, we
+    // walk the combinations of the S pivot rows in Gray code order:
+    // consecutive codes differ only in bit i = ctz(g), so each entry is
+    // the previous one plus row s+i, and we track the bits p of the
+    // running sum within the block to know where it lands in Z[]...
+
+    uint64_t t0 = rdtsc();
+
+    int vv[S];
+    for (int i = 0; i < S; i++)
+      vv[i] = bits(A[s+i], s, S);
 
-    // first, clear Z[0]
-    z[0] = 0;
     for (int w = s/64; w < wds; w++)
       Z[0][w] = 0;
 
-    // now, for each pivot 0,...,S-1
-    for (int i = 0; i < S; i++) {
-      int ii = 1<<i;
-      int vv = bits(A[s+i], s, S);
-      // copy block of size 2^i and xor i-th row onto it
-      for (int j = 0; j < ii; j++) {
-        int a = z[j], b = a ^ vv;
-        z[j+ii] = b;
-        addrows (Z[b], Z[a], A[s+i], s/64, wds); } }
+    for (int g = 1, p = 0; g < SS; g++) {
+      int i = __builtin_ctz(g), q = p ^ vv[i];
+      addrows (Z[q], Z[p], A[s+i], s/64, wds);
+      p = q; }
+
+    tm_table += rdtsc() - t0;
 
     // now reduce below this full-rank block
     for (int i = s + S; i < m; i++) {
@@ -171,8 +193,7 @@ static int semi_ech(const int m, const int n, const int wds, uint64_t (*A)[wds],
           A[j][w] ^= A[r][w];
     r++, c++; }
 
-  free(Z);
-  free(z);
+  if (!work) free(Z);
   return r; }
 
 
@@ -249,6 +270,97 @@ int solution(const int m,    // height (rows)
   return b; }
 
 
+static void transpose64(uint64_t *a) {
+
+  // in place 64x64 bit transpose (bit j of a[i] <-> bit i of a[j]):
+  // six butterfly rounds, each swapping the off diagonal j x j blocks
+  // of every 2j x 2j block; for j >= 4 that is four rows at a time
+
+  typedef uint64_t v4 __attribute__((vector_size(32)));
+  static const uint64_t mask[6] = {
+    0x00000000ffffffffUL, 0x0000ffff0000ffffUL, 0x00ff00ff00ff00ffUL,
+    0x0f0f0f0f0f0f0f0fUL, 0x3333333333333333UL, 0x5555555555555555UL };
+
+  int l = 0;
+  for (int j = 32; j >= 4; j >>= 1, l++)
+    for (int k = 0; k < 64; k += 2*j)
+      for (int i = k; i < k + j; i += 4) {
+        v4 x, y, t;
+        memcpy(&x, a + i, sizeof x);
+        memcpy(&y, a + i + j, sizeof y);
+        t = ((x >> j) ^ y) & mask[l];
+        x ^= t << j, y ^= t;
+        memcpy(a + i, &x, sizeof x);
+        memcpy(a + i + j, &y, sizeof y); }
+  for (int j = 2; j >= 1; j >>= 1, l++)
+    for (int k = 0; k < 64; k += 2*j)
+      for (int i = k; i < k + j; i++) {
+        uint64_t t = ((a[i] >> j) ^ a[i+j]) & mask[l];
+        a[i] ^= t << j, a[i+j] ^= t; } }
+
+
+static void transpose(const int m, const int n,
+                      const int wa, uint64_t (*A)[wa],
+                      const int wt, uint64_t (*T)[wt]) {
+
+  // T (n x m) = A^T for A (m x n), a 64x64 block at a time; only the
+  // first (m+63)/64 words of the n rows of T are written
+
+  #pragma omp parallel for schedule(static)
+  for (int bi = 0; bi < (m+63)/64; bi++)
+    for (int bj = 0; bj < (n+63)/64; bj++) {
+      uint64_t blk[64];
+      for (int r = 0; r < 64; r++)
+        blk[r] = 64*bi + r < m ? A[64*bi + r][bj] : 0;
+      transpose64(blk);
+      for (int c = 0; c < 64 && 64*bj + c < n; c++)
+        T[64*bj + c][bi] = blk[c]; } }
+
+
+static void mul(const int m, const int n, const int k,
+                const int wa, uint64_t (*A)[wa],
+                const int wb, uint64_t (*B)[wb],
+                const int wc, uint64_t (*C)[wc],
+                int S, uint64_t *work) {
+
+  // C (m x k) = A (m x n) B (n x k), 4 Russians style: for each block
+  // of S rows of B build all 2^S sums (Gray code order, one addition
+  // each, as in semi_ech), then add the one picked out by the S bits
+  // of each row of A into that row of C. work, if given, holds the
+  // table: (1<<S) * (k+63)/64 words. Columns of A past n are ignored.
+
+  const int wk = (k + 63) / 64;
+  assert(wk <= wb && wk <= wc);
+  if (S == 0) S = table_bits(m, wk);
+  uint64_t (*Z)[wk] = work ? (void *) work : malloc((sizeof *Z) << S);
+  assert(Z);
+
+  for (int i = 0; i < m; i++)
+    for (int w = 0; w < wc; w++)
+      C[i][w] = 0;
+
+  for (int s = 0; s < n; s += S) {
+    const int b = S < n - s ? S : n - s;
+    for (int w = 0; w < wk; w++)
+      Z[0][w] = 0;
+    for (int g = 1, p = 0; g < (1<<b); g++) {
+      int i = __builtin_ctz(g), q = p ^ (1<<i);
+      for (int w = 0; w < wk; w++)
+        Z[q][w] = Z[p][w] ^ B[s+i][w];
+      p = q; }
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < m; i++) {
+      const uint64_t *z = Z[bits(A[i], s, b)];
+      for (int w = 0; w < wk; w++)
+        C[i][w] ^= z[w]; } }
+
+  if (k % 64) // B may have had bits (a rhs, say) past column k
+    for (int i = 0; i < m; i++)
+      C[i][wk-1] &= (1UL << (k%64)) - 1;
+
+  if (!work) free(Z); }
+
+
 // ----------------------------------------------------------------------
 // xorshiro128+ code, authored by David Blackman and Sebastiano Vigna
 
@@ -263,6 +375,9 @@ static uint64_t rand64(void) {
 
 
 #include "gf2.h"
+#include "sparse.h"
+#include "lanczos.h"
+#include "batch.h"
 
 
 void dump(const int m, const int n, const int b, const int wds,
@@ -340,24 +455,286 @@ void test_interface () {
     printf("kernel:\n");   dump(r, n, b, wds, K);
     printf("solution:\n"); dump(b, n, b, wds, W);
 
-    // check kernel with original copy
-    for (int i = 0; i < r; i++)
-      for (int j = 0; j < m; j++)
-        assert(dotprod(K[i], B[j], 0, wds) == 0);
+    // check kernel with original copy: B K^T = 0
+    uint64_t (*T)[1] = malloc(n * sizeof *T); // K^T, then W^T
+    uint64_t (*C)[1] = malloc(m * sizeof *C);
+    transpose(r, n, wds, K, 1, T);
+    mul(m, n, r, wds, B, 1, T, 1, C, 0, NULL);
+    for (int j = 0; j < m; j++)
+      assert(C[j][0] == 0);
 
-    // check solution with original copy
-    for (int i = 0; i < r; i++) {
-      uint64_t lhs = 0, rhs = bits(B[r], n, b);
-      for (int j = b-1; j >= 0; j--)
-        lhs = (lhs<<1) + dotprod(B[r], W[j], 0, wds);
-      if (lhs != rhs)
-        printf("i=%d lhs=%lx rhs=%lx\n", i, lhs, rhs); }
+    // check solution with original copy: B W^T = rhs
+    transpose(b, n, wds, W, 1, T);
+    mul(m, n, b, wds, B, 1, T, 1, C, 0, NULL);
+    for (int j = 0; j < m; j++)
+      assert(C[j][0] == bits(B[j], n, b));
 
     free(A); free(B);
     free(K); free(W);
+    free(T); free(C);
     free(piv); } }
 
 
+void test_mul () {
+
+  // transpose against the bit by bit definition (odd sizes, so the
+  // partial blocks get exercised), and A (B C) = (A B) C via gf2_mul
+
+  gf2_t A = { .m = 150, .n = 200 }, B = { .m = 200, .n = 130 },
+        C = { .m = 130, .n = 70 }, T = { 0 };
+  gf2_init(&A); gf2_init(&B); gf2_init(&C);
+  gf2_randomize(&A); gf2_randomize(&B); gf2_randomize(&C);
+
+  gf2_transpose(&T, &A);
+  uint64_t (*a)[A.wds] = A.matrix, (*t)[T.wds] = T.matrix;
+  for (int i = 0; i < A.m; i++)
+    for (int j = 0; j < A.n; j++)
+      assert(bit(a[i], j) == bit(t[j], i));
+
+  gf2_t AB = { 0 }, BC = { 0 }, AB_C = { 0 }, A_BC = { 0 };
+  gf2_mul(&AB, &A, &B); gf2_mul(&AB_C, &AB, &C);
+  gf2_mul(&BC, &B, &C); gf2_mul(&A_BC, &A, &BC);
+  assert(memcmp(AB_C.matrix, A_BC.matrix, A.m * AB_C.wds * 8) == 0);
+
+  // and one product against dot products of rows with columns
+  gf2_t Bt = { 0 };
+  gf2_transpose(&Bt, &B);
+  uint64_t (*ab)[AB.wds] = AB.matrix, (*bt)[Bt.wds] = Bt.matrix;
+  for (int i = 0; i < A.m; i++)
+    for (int j = 0; j < B.n; j++)
+      assert(bit(ab[i], j) == dotprod(a[i], bt[j], 0, Bt.wds));
+
+  printf("mul: transpose and products check out\n");
+  gf2_t *all[] = { &A, &B, &C, &T, &AB, &BC, &AB_C, &A_BC, &Bt };
+  for (int i = 0; i < 9; i++) gf2_clear(all[i]); }
+
+
+void test_sparse () {
+
+  // random sparse system: a few heavy columns, many light ones, and a
+  // mix of row lengths from singletons up; the kernel lifted from the
+  // dense core should match the corank of the full dense system
+
+  const int m = 600, n = 700, wds = (n + 63) / 64;
+  uint64_t (*B)[wds] = calloc(m, sizeof *B); // dense copy
+  gf2_csr_t A = { .m = m, .n = n };
+  A.start = malloc((m+1) * sizeof *A.start);
+  A.cols = malloc(m * 24 * sizeof *A.cols);
+  assert(B && A.start && A.cols);
+
+  A.start[0] = 0;
+  for (int r = 0; r < m; r++) {
+    int w = 1 + rand64() % 24;
+    for (int i = 0; i < w; i++) {
+      int c = rand64() % (i % 2 ? n : n/8);
+      B[r][c/64] |= 1UL << (c%64); }
+    A.start[r+1] = A.start[r];
+    for (int c = 0; c < n; c++)
+      if (bit(B[r], c))
+        A.cols[A.start[r+1]++] = c; }
+
+  gf2_t D = { .m = m, .n = n };
+  gf2_init(&D);
+  memcpy(D.matrix, B, m * sizeof *B);
+  gf2_semi_ech(&D);
+
+  gf2_sge_t sge = { 0 };
+  gf2_sge_init(&sge, &A);
+  gf2_sge_reduce(&sge);
+  gf2_t core = { 0 };
+  gf2_sge_core(&sge, &core);
+  int k = gf2_kernel(&core);
+  printf("sparse: %d x %d -> core %d x %d, kernel %d (dense corank %d)\n",
+         m, n, sge.cm, sge.cn, k, D.corank);
+  assert(k == D.corank);
+
+  uint64_t (*K)[wds] = malloc(k * sizeof *K);
+  assert(gf2_sge_lift(&sge, &core, k, wds, K) == k);
+
+  for (int i = 0; i < k; i++)
+    for (int j = 0; j < m; j++)
+      assert(dotprod(K[i], B[j], 0, wds) == 0);
+
+  gf2_t X = { .m = k, .n = n };
+  gf2_init(&X);
+  memcpy(X.matrix, K, k * sizeof *K);
+  assert(gf2_semi_ech(&X) == k); // independent
+
+  gf2_clear(&X); gf2_clear(&core); gf2_clear(&D);
+  gf2_sge_clear(&sge);
+  free(A.start); free(A.cols);
+  free(B); free(K); }
+
+
+static void random_csr(gf2_csr_t *A, int m, int n, int w) {
+  // m rows of w distinct random columns each
+  A->m = m, A->n = n;
+  A->start = malloc((m+1) * sizeof *A->start);
+  A->cols = malloc((long) m * w * sizeof *A->cols);
+  assert(A->start && A->cols && w <= n);
+  A->start[0] = 0;
+  for (int r = 0; r < m; r++) {
+    int *c = A->cols + A->start[r], l = 0;
+    while (l < w) {
+      int x = rand64() % n, i = l;
+      while (i > 0 && c[i-1] > x) i--;
+      if (i > 0 && c[i-1] == x) continue;
+      memmove(c+i+1, c+i, (l-i) * sizeof *c);
+      c[i] = x, l++; }
+    A->start[r+1] = A->start[r] + w; } }
+
+static int csr_check(const gf2_csr_t *A, int k, int wds, uint64_t (*K)[wds]) {
+  // number of (row, kernel vector) pairs that fail
+  int bad = 0;
+  for (int i = 0; i < k; i++)
+    for (int r = 0; r < A->m; r++) {
+      uint64_t p = 0;
+      for (long l = A->start[r]; l < A->start[r+1]; l++)
+        p ^= bit(K[i], A->cols[l]);
+      bad += p; }
+  return bad; }
+
+void test_lanczos () {
+
+  const int m = 2000, n = 2100, wds = (n + 63) / 64;
+  gf2_csr_t A;
+  random_csr(&A, m, n, 20);
+  uint64_t (*K)[wds] = malloc(64 * sizeof *K);
+  int k = block_lanczos(&A, 64, wds, K);
+  printf("lanczos: %d x %d, kernel %d\n", m, n, k);
+  assert(k > 32); // expect close to 64
+  assert(csr_check(&A, k, wds, K) == 0);
+
+  gf2_t X = { .m = k, .n = n };
+  gf2_init(&X);
+  memcpy(X.matrix, K, k * sizeof *K);
+  assert(gf2_semi_ech(&X) == k);
+
+  gf2_clear(&X);
+  free(A.start); free(A.cols); free(K); }
+
+
+void test_batch () {
+
+  // a batch of small systems with rhs; ranks should agree with
+  // semi_ech, kernels and solutions should check out on the originals
+
+  gf2_batch_t X = { .count = 100, .m = 60, .n = 64, .b = 3 };
+  gf2_batch_init(&X);
+  const int m = X.m, n = X.n, b = X.b, wds = X.wds, count = X.count;
+  for (long i = 0; i < (long) count * m * wds; i++)
+    X.matrix[i] = rand64() & rand64(); // sparser, for some corank
+  uint64_t (*B)[wds] = malloc((long) count * m * sizeof *B);
+  uint64_t (*C)[wds] = malloc(m * sizeof *C);
+  memcpy(B, X.matrix, (long) count * m * sizeof *B);
+
+  int ok = gf2_batch_solve(&X);
+
+  for (int i = 0; i < count; i++) {
+    uint64_t (*A)[wds] = B + (long) i * m;
+    memcpy(C, A, m * sizeof *C);
+    assert(X.rank[i] == semi_ech(m, n, wds, C, 0, NULL, NULL));
+    uint64_t (*K)[wds] = (void *) gf2_batch_kernel(&X, i);
+    for (int k = 0; k < X.corank[i]; k++)
+      for (int j = 0; j < m; j++)
+        assert(dotprod(K[k], A[j], 0, wds) == 0);
+    if (X.status[i] < 0) continue;
+    uint64_t (*W)[wds] = (void *) gf2_batch_solution(&X, i);
+    for (int j = 0; j < m; j++)
+      for (int k = 0; k < b; k++) // x_k . row == rhs bit k
+        assert(dotprod(W[k], A[j], 0, wds) == bit(A[j], n+k)); }
+
+  printf("batch: %d systems of %d x %d, %d consistent\n", count, m, n, ok);
+  gf2_batch_clear(&X);
+  free(B); free(C); }
+
+
+void test_add_row () {
+
+  // add random rows one at a time with the identity block tracking
+  // combinations; every dependency should be the sum of the rows its
+  // augmented bits name, and the final form should match semi_ech
+
+  gf2_t X = { .m = 240, .n = 256, .b = 1, .augment = 1 };
+  gf2_init(&X);
+  const int m = X.m, n = X.n, b = X.b, wds = X.wds;
+  uint64_t (*B)[wds] = calloc(m, sizeof *B); // rows as added
+  uint64_t *x = malloc(wds * sizeof *x);
+
+  int deps = 0, full = -1;
+  for (int i = 0; i < m; i++) {
+    for (int j = 0; j < (n+b+63)/64; j++) // every 7th a dependency
+      B[i][j] = i%7 == 6 ? B[i-1][j] ^ B[i-3][j] : rand64() & rand64();
+    for (int c = n+b; c < 64*wds; c++) // clear pad and identity
+      B[i][c/64] &= ~(1UL << (c%64));
+    memcpy(x, B[i], wds * sizeof *x);
+    if (gf2_add_row(&X, x) >= 0) continue;
+    if (full < 0) full = i;
+    deps++;
+    for (int c = 0; c < n+b; c++) {
+      uint64_t sum = 0;
+      for (int j = 0; j <= i; j++)
+        sum ^= bit(x, n+b+j) & bit(B[j], c);
+      assert(sum == bit(x, c)); } }
+
+  uint64_t (*C)[wds] = malloc(m * sizeof *C);
+  memcpy(C, B, m * sizeof *C);
+  assert(X.rank == semi_ech(m, n, wds, C, 0, NULL, NULL));
+  assert(X.rank + deps == m);
+
+  int k = gf2_kernel(&X);
+  uint64_t (*K)[wds] = X.kernel;
+  for (int i = 0; i < k; i++)
+    for (int j = 0; j < m; j++)
+      assert(dotprod(K[i], B[j], 0, wds) == 0);
+
+  printf("add_row: %d rows, rank %d, first dependency at row %d\n",
+         m, X.rank, full);
+  gf2_clear(&X);
+  free(B); free(C); free(x); }
+
+
+void test_file () {
+
+  // round trip through the file format: write a random system, map
+  // it and load it, solve the mapped copy and write the results out
+
+  char path[] = "/tmp/gf2-XXXXXX";
+  close(mkstemp(path));
+
+  gf2_t X = { .m = 120, .n = 130, .b = 2 }; // wds 3, so rows get padded
+  gf2_init(&X);
+  gf2_randomize(&X);
+  const int wds = X.wds;
+  uint64_t (*A)[wds] = X.matrix;
+  gf2_write_matrix(&X, path);
+
+  gf2_t Y = { .file = path };
+  gf2_init(&Y);
+  assert(Y.m == X.m && Y.n == X.n && Y.b == X.b && Y.wds == 8);
+  uint64_t (*M)[Y.wds] = Y.matrix;
+  for (int r = 0; r < X.m; r++)
+    for (int w = 0; w < Y.wds; w++)
+      assert(M[r][w] == (w < wds ? A[r][w] : 0));
+
+  gf2_t Z = { 0 };
+  gf2_load(&Z, path);
+  assert(memcmp(Z.matrix, Y.matrix, (long) Y.m * Y.wds * 8) == 0);
+
+  gf2_kernel(&Y);
+  int s = gf2_solution(&Y);
+  gf2_write_kernel(&Y, path);
+  gf2_t K = { 0 };
+  gf2_load(&K, path);
+  assert(K.m == Y.corank && K.n == Y.n && K.b == 0);
+  assert(memcmp(K.matrix, Y.kernel, (long) K.m * K.wds * 8) == 0);
+
+  printf("file: %d x %d mapped and loaded, corank %d, solution %d\n",
+         Y.m, Y.n, Y.corank, s);
+  unlink(path);
+  gf2_clear(&X); gf2_clear(&Y); gf2_clear(&Z); gf2_clear(&K); }
+
+
 // ----------------------------------------------------------------------
 
 #include <time.h>
@@ -367,6 +744,85 @@ static double wall () {
   return t.tv_sec + t.tv_nsec/1e9; }
 
 
+void compare_lanczos () {
+
+  // driver: block Lanczos against the dense path on a random sparse
+  // system with w entries per row (dense=0 to skip the latter)
+
+  int n     = atoi(getenv("n")     ?: "20000");
+  int m     = atoi(getenv("m")     ?: "0");
+  int w     = atoi(getenv("w")     ?: "30");
+  int dense = atoi(getenv("dense") ?: "1");
+  if (m == 0) m = n - 100;
+  const int wds = (n + 63) / 64;
+
+  printf("m=%d n=%d w=%d\n", m, n, w);
+  gf2_csr_t A;
+  random_csr(&A, m, n, w);
+  uint64_t (*K)[wds] = malloc(64 * sizeof *K);
+  assert(K);
+
+  double tm = wall();
+  int k = block_lanczos(&A, 64, wds, K);
+  tm = wall() - tm;
+  printf("lanczos: %d kernel vectors in %.3f seconds (%s)\n", k, tm,
+         csr_check(&A, k, wds, K) ? "FAILED" : "checked");
+
+  if (dense) {
+    gf2_t X = { .m = m, .n = n, .kmax = 64 };
+    tm = wall();
+    gf2_init(&X);
+    uint64_t (*B)[X.wds] = X.matrix;
+    for (int r = 0; r < m; r++)
+      for (long l = A.start[r]; l < A.start[r+1]; l++)
+        B[r][A.cols[l]/64] |= 1UL << (A.cols[l]%64);
+    gf2_kernel(&X);
+    tm = wall() - tm;
+    printf("dense:   corank %d in %.3f seconds\n", X.corank, tm);
+    gf2_clear(&X); }
+
+  free(A.start); free(A.cols); free(K); }
+
+
+void compare_batch () {
+
+  // driver: systems per second for a batch of small systems against
+  // calling semi_ech, kernel and solution on each in turn
+
+  int count = atoi(getenv("batch") ?: "100000");
+  int n     = atoi(getenv("n")     ?: "64");
+  int m     = atoi(getenv("m")     ?: "0");
+  int b     = atoi(getenv("b")     ?: "1");
+  if (m == 0) m = n;
+
+  gf2_batch_t X = { .count = count, .m = m, .n = n, .b = b };
+  gf2_batch_init(&X);
+  const int wds = X.wds;
+  printf("batch=%d m=%d n=%d b=%d wds=%d\n", count, m, n, b, wds);
+  for (long i = 0; i < (long) count * m * wds; i++)
+    X.matrix[i] = rand64();
+  uint64_t *B = malloc((long) count * m * wds * sizeof *B);
+  memcpy(B, X.matrix, (long) count * m * wds * sizeof *B);
+
+  double tm = wall();
+  gf2_batch_solve(&X);
+  tm = wall() - tm;
+  printf("batched: %.0f systems/second\n", count / tm);
+
+  int *piv = malloc(m * sizeof *piv);
+  tm = wall();
+  for (int i = 0; i < count; i++) {
+    uint64_t (*A)[wds] = (void *) (B + (long) i * m * wds);
+    int r = semi_ech(m, n, wds, A, 0, piv, NULL);
+    if (r < n) kernel(m, n, wds, A, piv, X.kmax, (void *) gf2_batch_kernel(&X, i));
+    if (b) solution(m, n, wds, A, piv, b, (void *) gf2_batch_solution(&X, i)); }
+  tm = wall() - tm;
+  printf("one by one: %.0f systems/second\n", count / tm);
+
+  gf2_batch_clear(&X);
+  free(B); free(piv); }
+
+
 int main (int argc, char *argv[]) {
 
   for (++argv; --argc; ++argv)
@@ -374,20 +830,37 @@ int main (int argc, char *argv[]) {
       putenv(*argv);
 
   if (1) test_interface();
+  if (1) test_mul();
+  if (1) test_sparse();
+  if (1) test_lanczos();
+
+  if (1) test_batch();
+  if (1) test_add_row();
+  if (1) test_file();
+
+  if (getenv("lanczos")) {
+    compare_lanczos();
+    return 0; }
+
+  if (getenv("batch")) {
+    compare_batch();
+    return 0; }
 
   int n      = atoi(getenv("n")      ?: "4096");
   int m      = atoi(getenv("m")      ?: "0");
   int trials = atoi(getenv("trials") ?: "1000");
   int seed   = atoi(getenv("seed")   ?: "0");
-  int S      = atoi(getenv("S")      ?: "8");
+  int S      = atoi(getenv("S")      ?: "0");
 
   if (m == 0) m = n;
   if (seed == 0) seed = time(0);
   state[0] = state[1] = seed;
 
   const int wds  = (n + 63) / 64;
+  if (S == 0) S = table_bits(m, wds);
   uint64_t (*A)[wds] = malloc(m * sizeof *A); // A[m][wds];
-  assert(A);
+  uint64_t *Z = calloc((1<<S) * wds, sizeof *Z); // table, reused by every trial
+  assert(A && Z);
 
   printf("m=%d n=%d (S=%d trials=%d)\n", m, n, S, trials);
 
@@ -398,7 +871,8 @@ int main (int argc, char *argv[]) {
   volatile double tm = 0;
   double rr = 0;
 
-  uint64_t min_tm1 = ~0UL;
+  uint64_t min_tm1 = ~0UL, sum_tm1 = 0;
+  tm_table = 0;
   int count = 0;
   for (; count < trials; count++) {
 
@@ -408,9 +882,10 @@ int main (int argc, char *argv[]) {
 
     tm -= wall();
     volatile uint64_t tm1 = rdtsc();
-    int r = semi_ech(m, n, wds, A, S, NULL);
+    int r = semi_ech(m, n, wds, A, S, NULL, Z);
     tm1 = rdtsc() - tm1;
     if (tm1 < min_tm1) min_tm1 = tm1;
+    sum_tm1 += tm1;
     tm += wall();
 
     rr += r; }
@@ -424,8 +899,9 @@ int main (int argc, char *argv[]) {
   else if (tm < 1e-3)  printf("avg %.8f milliseconds\n", tm*1e3);
   else                 printf("avg %.8f seconds\n", tm);
   printf("min tm1 = %ld\n", min_tm1);
+  printf("table build = %.1f%% of time\n", 100.0 * tm_table / sum_tm1);
 
-  free(A);
+  free(A); free(Z);
 
   return 0; }
 
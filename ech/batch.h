@@ -0,0 +1,168 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "gf2.h"
+
+// ----------------------------------------------------------------------
+// many small independent systems of the same shape (say 64x64 up to
+// 256x256), stored back to back. Here the 4 Russians tables don't pay
+// for themselves, and per call set-up dominates, so we use a plain
+// elimination specialised on the row width: for wds <= 4 a row is a
+// single AVX2 register's worth and every row operation is unrolled.
+// Wider systems go through semi_ech, where the tables start to win.
+// Systems are spread over threads; nothing is allocated per system.
+
+typedef struct {
+  // --- required user input parameters:
+  int count;          // number of systems
+  int m;              // number of rows (each system)
+  int n;              // number of (bit) columns
+  int b;              // number of rhs columns
+  // --- optional parameters (defaults will be computed)
+  int wds;            // width of each matrix in words
+  int kmax;           // max number of kernel vectors per system
+  // --- flags
+  int inited;
+  int free_matrix, free_kernel, free_solution, free_info;
+  // --- storage; system i starts at i*m*wds, i*kmax*wds, i*b*wds
+  uint64_t *matrix;   // count * m * wds words
+  uint64_t *kernel;   // count * kmax * wds words
+  uint64_t *solution; // count * b * wds words (if b > 0)
+  int *pivots;        // count * m
+  // --- computed data (count entries each)
+  int *rank;          // rank of each system
+  int *corank;        // number of kernel vectors returned
+  int *status;        // from solution(): b, or -1 if inconsistent
+} gf2_batch_t;
+
+
+static inline __attribute__((always_inline))
+int ech_small(const int m, const int n, const int wds, uint64_t (*A)[wds],
+              int *piv) {
+
+  // same result as semi_ech (rows in semi-echelon form, pivots in
+  // piv[]), but swapping rows into place and clearing below without
+  // branches; rows below r are zero left of column c, so with wds
+  // constant we can always work on whole rows
+
+  int r = 0;
+  for (int i = 0; i < m; i++) piv[i] = -1;
+  for (int c = 0; r < m && c < n; c++) {
+    const int cw = c/64;
+    const uint64_t probe = 1UL << (c%64);
+    int j;
+    for (j = r; j < m; j++)
+      if (A[j][cw] & probe) break;
+    if (j == m) continue;
+    if (j != r)
+      for (int w = 0; w < wds; w++) {
+        uint64_t t = A[r][w];
+        A[r][w] = A[j][w], A[j][w] = t; }
+    piv[r] = c;
+    for (j++; j < m; j++) {
+      uint64_t mask = -(uint64_t) ((A[j][cw] & probe) != 0);
+      for (int w = 0; w < wds; w++)
+        A[j][w] ^= A[r][w] & mask; }
+    r++; }
+  return r; }
+
+static int semi_ech_small(const int m, const int n, const int wds,
+                          uint64_t (*A)[wds], int *piv, int S, uint64_t *Z) {
+  switch (wds) { // let the compiler see the constant widths
+  case 1: return ech_small(m, n, 1, (uint64_t (*)[1]) A, piv);
+  case 2: return ech_small(m, n, 2, (uint64_t (*)[2]) A, piv);
+  case 3: return ech_small(m, n, 3, (uint64_t (*)[3]) A, piv);
+  case 4: return ech_small(m, n, 4, (uint64_t (*)[4]) A, piv);
+  default: return semi_ech(m, n, wds, A, S, piv, Z); } }
+
+
+void gf2_batch_init(gf2_batch_t *data) {
+  assert(data->count > 0);
+  assert(data->n > 0);
+  assert(data->m > 0);
+  const long count = data->count;
+  if (data->wds == 0)
+    data->wds = (data->n + data->b + 64-1)/64;
+  if (data->kmax == 0)
+    data->kmax = data->n;
+  if (data->matrix == NULL) {
+    data->matrix = calloc(count * data->m * data->wds, sizeof(uint64_t));
+    assert(data->matrix);
+    data->free_matrix = 1;
+  }
+  if (data->kernel == NULL) {
+    data->kernel = calloc(count * data->kmax * data->wds, sizeof(uint64_t));
+    assert(data->kernel);
+    data->free_kernel = 1;
+  }
+  if (data->solution == NULL && data->b > 0) {
+    data->solution = calloc(count * data->b * data->wds, sizeof(uint64_t));
+    assert(data->solution);
+    data->free_solution = 1;
+  }
+  if (data->pivots == NULL) {
+    // one block for pivots and the per system results
+    data->pivots = malloc(count * (data->m + 3) * sizeof(int));
+    assert(data->pivots);
+    data->rank   = data->pivots + count * data->m;
+    data->corank = data->rank + count;
+    data->status = data->corank + count;
+    data->free_info = 1;
+  }
+  data->inited = 1;
+}
+
+
+void gf2_batch_clear(gf2_batch_t *data) {
+  if (data->matrix && data->free_matrix)
+    { free(data->matrix); data->matrix = NULL; }
+  if (data->kernel && data->free_kernel)
+    { free(data->kernel); data->kernel = NULL; }
+  if (data->solution && data->free_solution)
+    { free(data->solution); data->solution = NULL; }
+  if (data->pivots && data->free_info)
+    { free(data->pivots); data->pivots = NULL; }
+  data->inited = 0;
+}
+
+
+static inline uint64_t *gf2_batch_matrix(gf2_batch_t *data, int i) {
+  return data->matrix + (long) i * data->m * data->wds; }
+
+static inline uint64_t *gf2_batch_kernel(gf2_batch_t *data, int i) {
+  return data->kernel + (long) i * data->kmax * data->wds; }
+
+static inline uint64_t *gf2_batch_solution(gf2_batch_t *data, int i) {
+  return data->solution + (long) i * data->b * data->wds; }
+
+
+int gf2_batch_solve(gf2_batch_t *data) {
+
+  // echelonize every system, then fill in kernels and (if b > 0)
+  // particular solutions; returns the number of consistent systems
+
+  assert(data->inited);
+  const int m = data->m, n = data->n, b = data->b, wds = data->wds;
+  const int S = wds > 4 ? table_bits(m, wds) : 0;
+  int ok = 0;
+
+  #pragma omp parallel reduction(+:ok)
+  {
+    // wide systems need a 4R table; one per thread
+    uint64_t *Z = S ? malloc((sizeof *Z * wds) << S) : NULL;
+    #pragma omp for schedule(static)
+    for (int i = 0; i < data->count; i++) {
+      uint64_t (*A)[wds] = (void *) gf2_batch_matrix(data, i);
+      int *piv = data->pivots + (long) i * m;
+      int r = data->rank[i] = semi_ech_small(m, n, wds, A, piv, S, Z);
+      data->corank[i] = r < n ?
+        kernel(m, n, wds, A, piv, data->kmax, (void *) gf2_batch_kernel(data, i)) : 0;
+      data->status[i] = b ?
+        solution(m, n, wds, A, piv, b, (void *) gf2_batch_solution(data, i)) : 0;
+      ok += data->status[i] >= 0; }
+    free(Z);
+  }
+
+  return ok; }
+
+#endif
@@ -4,13 +4,29 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <assert.h>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 // prototypes of the external functions that actually do the heavy lifting...
 
 static int semi_ech(const int m, const int n, const int wds, uint64_t (*A)[wds],
-                    int S, int *piv);
+                    int S, int *piv, uint64_t *work);
+
+static int table_bits(const int m, const int wds);
+
+static void transpose(const int m, const int n,
+                      const int wa, uint64_t (*A)[wa],
+                      const int wt, uint64_t (*T)[wt]);
+
+static void mul(const int m, const int n, const int k,
+                const int wa, uint64_t (*A)[wa],
+                const int wb, uint64_t (*B)[wb],
+                const int wc, uint64_t (*C)[wc],
+                int S, uint64_t *work);
 
 static int kernel(const int m,    // height (rows)
                   const int n,    // width in bits
@@ -29,6 +45,21 @@ int solution(const int m,    // height (rows)
              uint64_t (*X)[wds]);
 
 
+// ----------------------------------------------------------------------
+// on-disk format: a 64 byte header, then the rows, each padded to a
+// multiple of 64 bytes (wds below is the padded width), so the file
+// can be mapped and used directly as a matrix
+
+#define GF2_MAGIC 0x3130544d32464700UL // "\0GF2MT01"
+
+typedef struct {
+  uint64_t magic;
+  int64_t m, n, b;    // rows, bit columns, rhs columns
+  int64_t wds;        // words per row, a multiple of 8
+  int64_t pad[3];
+} gf2_header_t;
+
+
 // ----------------------------------------------------------------------
 // data structure for managing information related to solving
 // linear systems over GF(2)...
@@ -42,34 +73,74 @@ typedef struct {
   int wds;            // width of matrix in words
   int kmax;           // max number of kernel vectors (user can set to limit them)
   int tablebits;      // number of bits for 4 Russians tables
+  int augment;        // gf2_add_row: identity block in columns n+b..n+b+m-1
+  long worksize;      // words of scratch space (see gf2_worksize)
   // --- flags
   int inited;         // inited?
   int ech;            // flag to indicate semi-ech form
   // flags to indicate the corresponding arrays need to be free'd
   // (the user may have provided their own arrays, for example)
-  int free_matrix, free_kernel, free_solution, free_pivots;
+  int free_matrix, free_kernel, free_solution, free_pivots, free_work;
   // --- storage
   void *matrix;       // flattened array of m * wds words
   void *kernel;       // flattened array of k * wds words
   void *solution;     // if non-null, a particular solution  (b * wds words)
   int  *pivots;       // pivots
+  void *work;         // scratch arena: 4R table, then solution and kernel
+  const char *file;   // if set, gf2_init maps the matrix from this file
+  void *map;          // the mapping (header included), unmapped by gf2_clear
+  long mapsize;
   // --- computed data
   int rank;           // rank of system
   int corank;         // rank of kernel
+  int rows;           // rows added so far by gf2_add_row
 } gf2_t;
 
 
+long gf2_worksize(const gf2_t *data) {
+  // words of scratch space needed for the parameters as set (call
+  // after gf2_init, or fill in wds and tablebits first); kernel space
+  // is only included if kmax has been set
+  return ((1L << data->tablebits) + data->b + data->kmax) * data->wds; }
+
+
+static void gf2_read_header(const char *path, gf2_header_t *h) {
+  int fd = open(path, O_RDONLY);
+  assert(fd != -1);
+  long bytes = pread(fd, h, sizeof *h, 0);
+  assert(bytes == sizeof *h);
+  assert(h->magic == GF2_MAGIC && h->wds % 8 == 0);
+  close(fd); }
+
+
 void gf2_init(gf2_t *data) {
+  // a matrix file: take the shape from its header and map the rows
+  // privately (the file is never written to; touched pages are copied)
+  if (data->file && data->matrix == NULL) {
+    gf2_header_t h;
+    gf2_read_header(data->file, &h);
+    data->m = h.m, data->n = h.n, data->b = h.b, data->wds = h.wds;
+    int fd = open(data->file, O_RDONLY);
+    assert(fd != -1);
+    data->mapsize = sizeof h + h.m * h.wds * sizeof(uint64_t);
+    data->map = mmap(NULL, data->mapsize, PROT_READ|PROT_WRITE,
+                     MAP_PRIVATE, fd, 0);
+    assert(data->map != MAP_FAILED);
+    close(fd);
+    data->matrix = (char *) data->map + sizeof h;
+    data->free_matrix = 0;
+  }
   assert(data->n > 0);
   assert(data->m > 0);
   // user may set data->wds to save space for a RHS or book-keeping columns
   if (data->wds == 0) 
-    data->wds = (data->n + data->b + 64-1)/64;
+    data->wds = (data->n + data->b + (data->augment ? data->m : 0) + 64-1)/64;
+  assert(!data->augment || data->wds * 64 >= data->n + data->b + data->m);
   if (data->tablebits == 0)
-    data->tablebits = log(data->m);
+    data->tablebits = table_bits(data->m, data->wds);
   // user may allocate their own array space
   if (data->matrix == NULL) {
-    data->matrix = calloc(data->m * data->wds, sizeof(uint64_t));
+    data->matrix = calloc((long) data->m * data->wds, sizeof(uint64_t));
     assert(data->matrix);
     data->free_matrix = 1;
   }
@@ -79,6 +150,22 @@ void gf2_init(gf2_t *data) {
     assert(data->pivots);
     data->free_pivots = 1;
   }
+  // one arena for everything the solve routines need, so that repeated
+  // solves never go back to the allocator (calloc also faults it in)
+  if (data->worksize == 0)
+    data->worksize = gf2_worksize(data);
+  assert(data->worksize >= gf2_worksize(data));
+  if (data->work == NULL) {
+    data->work = calloc(data->worksize, sizeof(uint64_t));
+    assert(data->work);
+    data->free_work = 1;
+  }
+  uint64_t *spare = (uint64_t *) data->work + (data->wds << data->tablebits);
+  if (data->solution == NULL && data->b > 0)
+    data->solution = spare, data->free_solution = 0;
+  spare += data->b * data->wds;
+  if (data->kernel == NULL && data->kmax > 0)
+    data->kernel = spare, data->free_kernel = 0;
   data->rank = -1;
   data->ech = 0;
   data->inited = 1;
@@ -94,6 +181,17 @@ void gf2_clear(gf2_t *data) {
     { free(data->kernel); data->kernel = NULL; }
   if (data->solution && data->free_solution)
     { free(data->solution); data->solution = NULL; }
+  if (data->work && data->free_work) {
+    // drop any kernel/solution pointers into the arena along with it
+    uint64_t *lo = data->work, *hi = lo + data->worksize;
+    if ((uint64_t *) data->kernel >= lo && (uint64_t *) data->kernel < hi)
+      data->kernel = NULL;
+    if ((uint64_t *) data->solution >= lo && (uint64_t *) data->solution < hi)
+      data->solution = NULL;
+    free(data->work); data->work = NULL; }
+  if (data->map) {
+    munmap(data->map, data->mapsize);
+    data->map = data->matrix = NULL; }
   data->inited = 0;
 }
 
@@ -102,7 +200,7 @@ int gf2_semi_ech(gf2_t *data) {
   // while (void *) might be evil, the user is responsible for ensuring A points
   // to an array of the appropriate form
   data->rank   = semi_ech(data->m, data->n, data->wds, data->matrix, 
-                          data->tablebits, data->pivots);
+                          data->tablebits, data->pivots, data->work);
   data->corank = data->n - data->rank;
   data->ech = 1;
   return data->rank;
@@ -139,6 +237,67 @@ int gf2_solution(gf2_t *data) {
 }
 
 
+int gf2_add_row(gf2_t *data, uint64_t *row) {
+
+  // incremental form: reduce row against the pivot rows so far; if
+  // anything is left in the first n columns it becomes a new pivot row
+  // (kept in order of pivot column, as kernel() and solution() expect)
+  // and we return its pivot, otherwise return -1. Either way the
+  // reduced row is copied back, so for a dependency its rhs bits say
+  // whether it is consistent and, with augment set, bits n+b+i say
+  // which of the added rows i sum to it. Starts from an empty matrix
+  // unless gf2_semi_ech has been called.
+
+  assert(data->inited);
+  const int m = data->m, n = data->n, wds = data->wds;
+  uint64_t (*A)[wds] = data->matrix;
+  int *piv = data->pivots;
+
+  if (!data->ech) {
+    for (int i = 0; i < m; i++) piv[i] = -1;
+    data->rank = data->rows = 0;
+    data->corank = n;
+    data->ech = 1; }
+  const int r = data->rank;
+  assert(r < m);
+
+  uint64_t *x = data->work; // first row of the 4R table space
+  memcpy(x, row, wds * sizeof *x);
+  if (data->augment) {
+    assert(data->rows < m);
+    const int a = n + data->b + data->rows;
+    x[a/64] |= 1UL << (a%64); }
+  data->rows++;
+
+  // rows are zero left of their pivot, so one pass in pivot order
+  // (only touching the words from the pivot on) clears all of them
+  for (int l = 0; l < r; l++) {
+    const int p = piv[l];
+    if (x[p/64] >> (p%64) & 1)
+      for (int w = p/64; w < wds; w++)
+        x[w] ^= A[l][w]; }
+
+  memcpy(row, x, wds * sizeof *x);
+
+  int c = -1;
+  for (int w = 0; w < (n+63)/64 && c < 0; w++) {
+    uint64_t v = x[w];
+    if (w == n/64) v &= (1UL << (n%64)) - 1;
+    if (v) c = 64*w + __builtin_ctzl(v); }
+  if (c < 0) return -1; // dependency
+
+  int l = r;
+  while (l > 0 && piv[l-1] > c) l--;
+  memmove(A[l+1], A[l], (r - l) * sizeof *A);
+  memmove(piv + l + 1, piv + l, (r - l) * sizeof *piv);
+  memcpy(A[l], x, sizeof *A);
+  piv[l] = c;
+
+  data->rank++;
+  data->corank--;
+  return c; }
+
+
 void gf2_randomize(gf2_t *data) {
   // NB: we don't care about zeroing out unused bits
   uint64_t rand64();
@@ -149,6 +308,126 @@ void gf2_randomize(gf2_t *data) {
       *arr++ = rand64();
 }
 
+void gf2_transpose(gf2_t *T, gf2_t *A) {
+  // T = A^T (rhs columns of A are dropped); T is set up here unless
+  // the caller has already done so
+  if (!T->inited) {
+    T->m = A->n, T->n = A->m;
+    gf2_init(T); }
+  assert(T->m == A->n && T->n == A->m);
+  transpose(A->m, A->n, A->wds, A->matrix, T->wds, T->matrix);
+  T->ech = 0; }
+
+
+void gf2_mul(gf2_t *C, gf2_t *A, gf2_t *B) {
+  // C = A B over the first n columns of each (rhs columns ignored); C
+  // is set up here unless the caller has already done so, and its
+  // work arena holds the 4 Russians table
+  assert(A->n == B->m);
+  if (!C->inited) {
+    C->m = A->m, C->n = B->n;
+    gf2_init(C); }
+  assert(C->m == A->m && C->n == B->n);
+  mul(A->m, A->n, B->n, A->wds, A->matrix, B->wds, B->matrix,
+      C->wds, C->matrix, C->tablebits, C->work);
+  C->ech = 0; }
+
+
+// ----------------------------------------------------------------------
+// file i/o: chunks of rows are read or written in parallel with
+// pread/pwrite (as cyc.cc does for permutations)
+
+static long gf2_pio(int fd, char *buf, long bytes, long off, int out) {
+  // pread/pwrite may stop short (at 2G on linux), so keep going
+  long done = 0;
+  while (done < bytes) {
+    long k = out ? pwrite(fd, buf + done, bytes - done, off + done)
+                 : pread (fd, buf + done, bytes - done, off + done);
+    if (k <= 0) break;
+    done += k; }
+  return done; }
+
+
+long gf2_load(gf2_t *data, const char *path) {
+
+  // read a matrix file into memory we own (as opposed to mapping it
+  // with .file); wds is taken from the file unless already set, in
+  // which case it must match. Returns bytes read.
+
+  gf2_header_t h;
+  gf2_read_header(path, &h);
+  data->m = h.m, data->n = h.n, data->b = h.b;
+  if (data->wds == 0) data->wds = h.wds;
+  assert(data->wds == h.wds);
+  gf2_init(data);
+
+  int fd = open(path, O_RDONLY);
+  assert(fd != -1);
+  const long row = h.wds * sizeof(uint64_t), chunk = (h.m + 63)/64;
+  long bytes = 0;
+  #pragma omp parallel for reduction(+:bytes)
+  for (int i = 0; i < 64; i++) {
+    long r0 = i * chunk, r1 = r0 + chunk < h.m ? r0 + chunk : h.m;
+    if (r0 < r1)
+      bytes += gf2_pio(fd, (char *) data->matrix + r0 * row, (r1 - r0) * row,
+                       sizeof h + r0 * row, 0); }
+  assert(bytes == h.m * row);
+  close(fd);
+  return bytes; }
+
+
+long gf2_write(const char *path, int m, int n, int b, int wds,
+               const void *rows) {
+
+  // write m rows of wds words in the file format, padding the rows
+  // out to 64 bytes if need be; returns bytes written
+
+  gf2_header_t h = { .magic = GF2_MAGIC, .m = m, .n = n, .b = b,
+                     .wds = (wds + 7) & ~7 };
+  int fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+  assert(fd != -1);
+  long bytes = gf2_pio(fd, (char *) &h, sizeof h, 0, 1);
+  const long row = h.wds * sizeof(uint64_t);
+  const uint64_t (*R)[wds] = rows;
+
+  if (wds == h.wds) { // already padded: big parallel writes
+    const long chunk = (m + 63)/64;
+    #pragma omp parallel for reduction(+:bytes)
+    for (int i = 0; i < 64; i++) {
+      long r0 = i * chunk, r1 = r0 + chunk < m ? r0 + chunk : m;
+      if (r0 < r1)
+        bytes += gf2_pio(fd, (char *) R[r0], (r1 - r0) * row,
+                         sizeof h + r0 * row, 1); } }
+  else { // pad through a buffer of rows
+    const int nb = 4096;
+    uint64_t (*buf)[h.wds] = calloc(nb, row);
+    assert(buf);
+    for (long r0 = 0; r0 < m; r0 += nb) {
+      int k = m - r0 < nb ? m - r0 : nb;
+      for (int i = 0; i < k; i++)
+        memcpy(buf[i], R[r0+i], wds * sizeof(uint64_t));
+      bytes += gf2_pio(fd, (char *) buf, k * row, sizeof h + r0 * row, 1); }
+    free(buf); }
+
+  assert(bytes == (long) sizeof h + m * row);
+  close(fd);
+  return bytes; }
+
+long gf2_write_matrix(gf2_t *data, const char *path) {
+  return gf2_write(path, data->m, data->n, data->b, data->wds, data->matrix); }
+
+long gf2_write_kernel(gf2_t *data, const char *path) {
+  // kernel vectors as rows, b=0; gf2_kernel must have been called
+  assert(data->kernel);
+  return gf2_write(path, data->corank < data->kmax ? data->corank : data->kmax,
+                   data->n, 0, data->wds, data->kernel); }
+
+long gf2_write_solution(gf2_t *data, const char *path) {
+  // one row per rhs column; gf2_solution must have succeeded
+  assert(data->solution);
+  return gf2_write(path, data->b, data->n, data->b, data->wds, data->solution); }
+
+
 void gf2_info(gf2_t *data) {
   printf("gf2{ m=%d, n=%d, wds=%d, rank=%d, corank=%d }\n",
          data->m, data->n, data->wds, data->rank, data->corank);
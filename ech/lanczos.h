@@ -0,0 +1,275 @@
+#ifndef LANCZOS_H
+#define LANCZOS_H
+
+#include <string.h>
+#include "sparse.h"
+
+// ----------------------------------------------------------------------
+// Block Lanczos (Montgomery, 1995) for the kernel of a sparse system
+// A x = 0 over GF(2). We iterate on the symmetric matrix A^T A with
+// blocks of 64 vectors, one uint64_t per coordinate (bit i belongs to
+// vector i), so each step is two sparse products plus a handful of
+// Nx64 by 64x64 products, and memory is the matrix plus a few vectors
+// of n words -- O(weight) rather than O(n^2).
+
+static void csr_transpose(const gf2_csr_t *A, gf2_csr_t *T) {
+  const long w = A->start[A->m];
+  T->m = A->n, T->n = A->m;
+  T->start = calloc(T->m + 1, sizeof *T->start);
+  T->cols = malloc((w > 0 ? w : 1) * sizeof *T->cols);
+  long *pos = malloc((T->m + 1) * sizeof *pos);
+  assert(T->start && T->cols && pos);
+  for (long l = 0; l < w; l++)
+    T->start[A->cols[l] + 1]++;
+  for (int c = 0; c < T->m; c++)
+    T->start[c+1] += T->start[c];
+  memcpy(pos, T->start, (T->m + 1) * sizeof *pos);
+  for (int r = 0; r < A->m; r++) // rows in order, so columns of T sorted
+    for (long l = A->start[r]; l < A->start[r+1]; l++)
+      T->cols[pos[A->cols[l]]++] = r;
+  free(pos); }
+
+static void csr_mul(const gf2_csr_t *A, const uint64_t *x, uint64_t *y) {
+  // y = A x for a block of 64 vectors
+  #pragma omp parallel for schedule(static)
+  for (int r = 0; r < A->m; r++) {
+    uint64_t t = 0;
+    for (long l = A->start[r]; l < A->start[r+1]; l++)
+      t ^= x[A->cols[l]];
+    y[r] = t; } }
+
+
+// dense helpers on blocks: a 64x64 matrix is 64 words, row i in word
+// i, entry (i,j) in bit j; an Nx64 block is n words
+
+static void mul_64x64_64x64(const uint64_t *a, const uint64_t *b, uint64_t *c) {
+  // c = a b; c may alias a or b
+  uint64_t t[64];
+  for (int i = 0; i < 64; i++) {
+    uint64_t x = 0, w = a[i];
+    for (int j = 0; w; j++, w >>= 1)
+      if (w & 1) x ^= b[j];
+    t[i] = x; }
+  memcpy(c, t, sizeof t); }
+
+static void mul_64xN_Nx64(const uint64_t *x, const uint64_t *y,
+                          uint64_t *xy, long n) {
+  // xy = x^T y; accumulate y[i] into one of 256 buckets per byte of
+  // x[i], then each output row is the sum of half the buckets
+  uint64_t c[8][256] = {{0}};
+  #pragma omp parallel
+  { uint64_t t[8][256] = {{0}};
+    #pragma omp for schedule(static)
+    for (long i = 0; i < n; i++) {
+      uint64_t w = x[i], v = y[i];
+      for (int k = 0; k < 8; k++, w >>= 8)
+        t[k][w & 255] ^= v; }
+    #pragma omp critical
+    for (int k = 0; k < 8; k++)
+      for (int j = 0; j < 256; j++)
+        c[k][j] ^= t[k][j]; }
+  for (int k = 0; k < 8; k++)
+    for (int b = 0; b < 8; b++) {
+      uint64_t a = 0;
+      for (int j = 0; j < 256; j++)
+        if (j >> b & 1) a ^= c[k][j];
+      xy[8*k + b] = a; } }
+
+static void mul_Nx64_64x64_acc(const uint64_t *v, const uint64_t *M,
+                               uint64_t *y, long n) {
+  // y += v M, using 8 tables of the 256 sums of each byte's rows of M
+  uint64_t T[8][256];
+  for (int k = 0; k < 8; k++) {
+    T[k][0] = 0;
+    for (int b = 0; b < 8; b++)
+      for (int j = 0; j < 1<<b; j++)
+        T[k][j | 1<<b] = T[k][j] ^ M[8*k + b]; }
+  #pragma omp parallel for schedule(static)
+  for (long i = 0; i < n; i++) {
+    uint64_t w = v[i], x = 0;
+    for (int k = 0; k < 8; k++, w >>= 8)
+      x ^= T[k][w & 255];
+    y[i] ^= x; } }
+
+
+static int find_nonsingular_sub(const uint64_t *t, int *s, const int *last_s,
+                                int last_dim, uint64_t *w) {
+
+  // choose the columns S_i for which t restricted is invertible,
+  // including every column not chosen last time (in last_s), and put
+  // the inverse on those columns in w. Gauss-Jordan on [t | I], trying
+  // columns missed last time first; when a column has no pivot, we
+  // use the identity half instead and throw that row away. Returns
+  // the number of columns chosen (now in s[0..dim)), 0 on failure.
+
+  uint64_t M[64][2], mask = 0;
+  for (int i = 0; i < 64; i++)
+    M[i][0] = t[i], M[i][1] = 1UL << i;
+
+  for (int i = 0; i < last_dim; i++)
+    mask |= 1UL << last_s[i], s[63 - i] = last_s[i];
+  for (int i = 0, j = 0; i < 64; i++)
+    if (!(mask >> i & 1)) s[j++] = i;
+
+  int dim = 0;
+  for (int i = 0; i < 64; i++) {
+    uint64_t *ri = M[s[i]], bit = 1UL << s[i];
+    int half = 0, j;
+    for (j = i; j < 64; j++)
+      if (M[s[j]][0] & bit) break;
+    if (j == 64) { // no pivot: compensate with the identity half
+      half = 1;
+      for (j = i; j < 64; j++)
+        if (M[s[j]][1] & bit) break;
+      if (j == 64) return 0; }
+    uint64_t *rj = M[s[j]], m0 = rj[0], m1 = rj[1];
+    rj[0] = ri[0], rj[1] = ri[1], ri[0] = m0, ri[1] = m1;
+    for (j = 0; j < 64; j++) {
+      uint64_t *r = M[s[j]];
+      if (r != ri && (r[half] & bit))
+        r[0] ^= ri[0], r[1] ^= ri[1]; }
+    if (half) ri[0] = ri[1] = 0;
+    else s[dim++] = s[i]; }
+
+  for (int i = 0; i < 64; i++)
+    w[i] = M[i][1];
+
+  // the recurrence needs every column in S_i or S_{i-1}
+  mask = 0;
+  for (int i = 0; i < dim; i++) mask |= 1UL << s[i];
+  for (int i = 0; i < last_dim; i++) mask |= 1UL << last_s[i];
+  return ~mask ? 0 : dim; }
+
+
+int block_lanczos(const gf2_csr_t *A, int k, int wds, uint64_t (*K)[wds]) {
+
+  // returns the number of independent kernel vectors put in K (at
+  // most min(k, 64)), rows laid out as for kernel()
+
+  uint64_t rand64();
+  const int m = A->m, n = A->n;
+  assert(n <= 64 * wds);
+
+  gf2_csr_t At;
+  csr_transpose(A, &At);
+
+  uint64_t *v[3], *vnext, *x, *v0, *t;
+  for (int i = 0; i < 3; i++)
+    v[i] = calloc(n, sizeof *v[i]);
+  vnext = malloc(n * sizeof *vnext);
+  x     = malloc(n * sizeof *x);
+  v0    = malloc(n * sizeof *v0);
+  t     = malloc((m > n ? m : n) * sizeof *t);
+  assert(v[0] && v[1] && v[2] && vnext && x && v0 && t);
+
+  uint64_t winv[3][64] = {{0}}, vt_a_v[2][64] = {{0}}, vt_a2_v[2][64] = {{0}};
+  uint64_t d[64], e[64], f[64], f2[64], mask0, mask1 = ~0UL;
+  int s[2][64], dim0 = 0, dim1 = 64;
+  for (int i = 0; i < 64; i++) s[1][i] = i;
+
+  // solve (A^T A) x = (A^T A) y for random y: start x = y, v_0 = A^T A y
+  for (int i = 0; i < n; i++) x[i] = rand64();
+  csr_mul(A, x, t);
+  csr_mul(&At, t, v[0]);
+  memcpy(v0, v[0], n * sizeof *v0);
+
+  for (int iter = 0; iter < n/60 + 100; iter++) {
+
+    csr_mul(A, v[0], t);
+    csr_mul(&At, t, vnext); // A^T A v_i
+    mul_64xN_Nx64(v[0], vnext, vt_a_v[0], n);
+    mul_64xN_Nx64(vnext, vnext, vt_a2_v[0], n);
+
+    // done once v_i is A-orthogonal to itself
+    int i;
+    for (i = 0; i < 64 && vt_a_v[0][i] == 0; i++);
+    if (i == 64) break;
+
+    dim0 = find_nonsingular_sub(vt_a_v[0], s[0], s[1], dim1, winv[0]);
+    if (dim0 == 0) break;
+    mask0 = 0;
+    for (i = 0; i < dim0; i++) mask0 |= 1UL << s[0][i];
+
+    // D = I - Winv_i (v_i^T A^2 v_i S S^T + v_i^T A v_i)
+    for (i = 0; i < 64; i++)
+      d[i] = (vt_a2_v[0][i] & mask0) ^ vt_a_v[0][i];
+    mul_64x64_64x64(winv[0], d, d);
+    for (i = 0; i < 64; i++) d[i] ^= 1UL << i;
+
+    // E = - Winv_{i-1} v_i^T A v_i S S^T
+    mul_64x64_64x64(winv[1], vt_a_v[0], e);
+    for (i = 0; i < 64; i++) e[i] &= mask0;
+
+    // F = - Winv_{i-2} (I - v_{i-1}^T A v_{i-1} Winv_{i-1})
+    //       (v_{i-1}^T A^2 v_{i-1} S' S'^T + v_{i-1}^T A v_{i-1}) S S^T
+    mul_64x64_64x64(vt_a_v[1], winv[1], f);
+    for (i = 0; i < 64; i++) f[i] ^= 1UL << i;
+    mul_64x64_64x64(winv[2], f, f);
+    for (i = 0; i < 64; i++)
+      f2[i] = ((vt_a2_v[1][i] & mask1) ^ vt_a_v[1][i]) & mask0;
+    mul_64x64_64x64(f, f2, f);
+
+    // v_{i+1} = A v_i S S^T + v_i D + v_{i-1} E + v_{i-2} F
+    for (int j = 0; j < n; j++) vnext[j] &= mask0;
+    mul_Nx64_64x64_acc(v[0], d, vnext, n);
+    mul_Nx64_64x64_acc(v[1], e, vnext, n);
+    mul_Nx64_64x64_acc(v[2], f, vnext, n);
+
+    // x += v_i Winv_i v_i^T v_0
+    mul_64xN_Nx64(v[0], v0, d, n);
+    mul_64x64_64x64(winv[0], d, d);
+    mul_Nx64_64x64_acc(v[0], d, x, n);
+
+    uint64_t *tmp = v[2];
+    v[2] = v[1], v[1] = v[0], v[0] = vnext, vnext = tmp;
+    memcpy(winv[2], winv[1], sizeof winv[1]);
+    memcpy(winv[1], winv[0], sizeof winv[0]);
+    memcpy(vt_a_v[1], vt_a_v[0], sizeof vt_a_v[0]);
+    memcpy(vt_a2_v[1], vt_a2_v[0], sizeof vt_a2_v[0]);
+    memcpy(s[1], s[0], sizeof s[0]);
+    mask1 = mask0, dim1 = dim0; }
+
+  // Now A^T A x lies in the span of the last v (usually zero), so
+  // look for combinations of the 128 columns of [x | v_m] that A
+  // kills: eliminate the rows [(A x)^T | I] and read off the
+  // combinations from rows that vanish in the first m bits.
+
+  const int dw = (m + 128 + 63) / 64;
+  uint64_t (*D)[dw] = calloc(128, sizeof *D);
+  int *piv = malloc(128 * sizeof *piv);
+  assert(D && piv);
+  for (int h = 0; h < 2; h++) {
+    csr_mul(A, h ? v[0] : x, t);
+    transpose(m, 64, 1, (void *) t, dw, D + 64*h); }
+  for (int j = 0; j < 128; j++)
+    D[j][(m+j)/64] |= 1UL << ((m+j)%64);
+  int r = semi_ech(128, m, dw, D, 0, piv, NULL);
+
+  // the (at most 64) combinations as columns of z = x Dx + v_m Dv
+  uint64_t Dx[64] = {0}, Dv[64] = {0};
+  for (int j = r; j < 128 && j < r + 64; j++)
+    for (int i = 0; i < 128; i++)
+      if (bit(D[j], m+i))
+        (i < 64 ? Dx : Dv)[i%64] |= 1UL << (j-r);
+  memset(vnext, 0, n * sizeof *vnext);
+  mul_Nx64_64x64_acc(x, Dx, vnext, n);
+  mul_Nx64_64x64_acc(v[0], Dv, vnext, n);
+
+  // as rows; echelonize to drop zero and dependent vectors
+  const int zw = (n + 63) / 64;
+  uint64_t (*Z)[zw] = calloc(64, sizeof *Z);
+  assert(Z);
+  transpose(n, 64, 1, (void *) vnext, zw, Z);
+  int q = semi_ech(64, n, zw, Z, 0, piv, NULL);
+  if (q > k) q = k;
+  for (int i = 0; i < q; i++)
+    for (int w = 0; w < wds; w++)
+      K[i][w] = w < zw ? Z[i][w] : 0;
+
+  free(Z); free(D); free(piv);
+  for (int i = 0; i < 3; i++) free(v[i]);
+  free(vnext); free(x); free(v0); free(t);
+  free(At.start); free(At.cols);
+  return q; }
+
+#endif
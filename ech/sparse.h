@@ -0,0 +1,316 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include <string.h>
+#include "gf2.h"
+
+// ----------------------------------------------------------------------
+// sparse matrices over GF(2) in compressed row form: row r has its
+// (strictly increasing) column indices in cols[start[r] .. start[r+1])
+
+typedef struct {
+  int m, n;      // rows, columns
+  long *start;   // m+1 row offsets into cols
+  int *cols;     // column indices
+} gf2_csr_t;
+
+
+// ----------------------------------------------------------------------
+// structured Gaussian elimination: shrink a sparse system A x = 0 to
+// a small dense core by eliminating variables that are cheap to
+// eliminate, recording how to recover them afterwards. Every step is
+// "eliminate column c using row r": x_c is the sum of the other
+// variables in row r, so add row r to every other row containing c,
+// then drop row r and column c. This covers
+//
+//   row singletons   r = {c}:     x_c = 0, c is cleared everywhere
+//   row doubletons   r = {c,d}:   x_c = x_d, column c merges into d
+//   column singletons wt(c) = 1:  row r goes, x_c follows from it
+//   light columns    wt(c) small: as above, with some fill-in
+//
+// The kernel of the dense core lifts back to the kernel of A by
+// replaying the recorded rows in reverse.
+
+typedef struct {
+  // --- optional parameters (defaults will be computed)
+  int maxw;           // merge columns of at most this weight
+  int maxlen;         // ... using pivot rows of at most this length
+  // --- the system being reduced
+  int m, n;           // size of original system
+  int **row, *len, *cap; // active rows (sorted column lists); len < 0: gone
+  int **col, *clen, *ccap; // rows containing each column (may be stale)
+  int *wt;            // column weights; -1 once eliminated
+  int *tmp, ntmp;     // scratch for merging rows
+  int *mark, stamp;   // scratch for deduplicating column lists
+  // --- lift stack: x[lcol[t]] = sum of x[j] for j in lcols[lstart[t]..]
+  int nlift;
+  int *lcol;
+  long *lstart, lsize;
+  int *lcols;
+  // --- the dense core
+  int cm, cn;         // rows and columns left
+  int *core_col;      // core column -> original column
+} gf2_sge_t;
+
+
+static void sge_push(int **v, int *len, int *cap, int x) {
+  if (*len == *cap) {
+    *cap = *cap ? 2 * *cap : 4;
+    *v = realloc(*v, *cap * sizeof **v);
+    assert(*v); }
+  (*v)[(*len)++] = x; }
+
+static int sge_has(const int *v, int len, int c) {
+  int lo = 0, hi = len;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (v[mid] < c) lo = mid + 1;
+    else hi = mid; }
+  return lo < len && v[lo] == c; }
+
+
+void gf2_sge_init(gf2_sge_t *sge, const gf2_csr_t *A) {
+  assert(A->m > 0 && A->n > 0);
+  if (sge->maxw == 0) sge->maxw = 8;
+  if (sge->maxlen == 0) sge->maxlen = 64;
+  int m = sge->m = A->m, n = sge->n = A->n;
+  sge->row  = calloc(m, sizeof *sge->row);
+  sge->len  = calloc(m, sizeof *sge->len);
+  sge->cap  = calloc(m, sizeof *sge->cap);
+  sge->col  = calloc(n, sizeof *sge->col);
+  sge->clen = calloc(n, sizeof *sge->clen);
+  sge->ccap = calloc(n, sizeof *sge->ccap);
+  sge->wt   = calloc(n, sizeof *sge->wt);
+  sge->mark = calloc(m, sizeof *sge->mark);
+  assert(sge->row && sge->len && sge->cap && sge->mark);
+  assert(sge->col && sge->clen && sge->ccap && sge->wt);
+  int maxlen = 0;
+  for (int r = 0; r < m; r++) {
+    int l = A->start[r+1] - A->start[r];
+    const int *c = A->cols + A->start[r];
+    sge->row[r] = malloc((sge->cap[r] = l > 0 ? l : 1) * sizeof(int));
+    assert(sge->row[r]);
+    for (int i = 0; i < l; i++) {
+      assert(0 <= c[i] && c[i] < n);
+      assert(i == 0 || c[i-1] < c[i]);
+      sge->row[r][i] = c[i];
+      sge->wt[c[i]]++;
+      sge_push(&sge->col[c[i]], &sge->clen[c[i]], &sge->ccap[c[i]], r); }
+    sge->len[r] = l;
+    if (l > maxlen) maxlen = l; }
+  sge->ntmp = 2*maxlen + 1;
+  sge->tmp = malloc(sge->ntmp * sizeof *sge->tmp);
+  assert(sge->tmp);
+  sge->stamp = 0;
+  sge->nlift = 0, sge->lsize = 0;
+  sge->lcol = NULL, sge->lcols = NULL;
+  sge->lstart = malloc(sizeof *sge->lstart);
+  sge->lstart[0] = 0;
+  sge->core_col = NULL;
+  sge->cm = sge->cn = 0; }
+
+
+void gf2_sge_clear(gf2_sge_t *sge) {
+  for (int r = 0; r < sge->m; r++) free(sge->row[r]);
+  for (int c = 0; c < sge->n; c++) free(sge->col[c]);
+  free(sge->row); free(sge->len); free(sge->cap);
+  free(sge->col); free(sge->clen); free(sge->ccap); free(sge->wt);
+  free(sge->mark);
+  free(sge->tmp); free(sge->lcol); free(sge->lstart); free(sge->lcols);
+  free(sge->core_col);
+  memset(sge, 0, sizeof *sge); }
+
+
+// live rows containing column c, compacting its (stale) list as we go;
+// returns the shortest of them (or -1)
+
+static int sge_rows(gf2_sge_t *sge, int c) {
+  int *v = sge->col[c], k = 0, best = -1;
+  ++sge->stamp; // rows can be listed twice after fill-in
+  for (int i = 0; i < sge->clen[c]; i++) {
+    int r = v[i];
+    if (sge->len[r] <= 0 || sge->mark[r] == sge->stamp ||
+        !sge_has(sge->row[r], sge->len[r], c))
+      continue;
+    sge->mark[r] = sge->stamp;
+    v[k++] = r;
+    if (best < 0 || sge->len[r] < sge->len[best]) best = r; }
+  sge->clen[c] = k;
+  assert(k == sge->wt[c]);
+  return best; }
+
+
+static void sge_eliminate(gf2_sge_t *sge, int c, int r) {
+
+  int *pr = sge->row[r], lr = sge->len[r];
+
+  // record x_c = sum of the rest of row r for lifting
+  sge->lcol = realloc(sge->lcol, (sge->nlift + 1) * sizeof *sge->lcol);
+  sge->lstart = realloc(sge->lstart, (sge->nlift + 2) * sizeof *sge->lstart);
+  sge->lcols = realloc(sge->lcols, (sge->lsize + lr) * sizeof *sge->lcols);
+  assert(sge->lcol && sge->lstart && sge->lcols);
+  for (int j = 0; j < lr; j++)
+    if (pr[j] != c) sge->lcols[sge->lsize++] = pr[j];
+  sge->lcol[sge->nlift++] = c;
+  sge->lstart[sge->nlift] = sge->lsize;
+
+  // add row r to every other row containing c
+  for (int t = 0; t < sge->clen[c]; t++) {
+    int i = sge->col[c][t];
+    if (i == r) continue;
+    int *pi = sge->row[i], li = sge->len[i], l = 0;
+    if (li + lr > sge->ntmp) {
+      sge->ntmp = 2 * (li + lr);
+      sge->tmp = realloc(sge->tmp, sge->ntmp * sizeof *sge->tmp);
+      assert(sge->tmp); }
+    for (int a = 0, b = 0; a < li || b < lr;) {
+      if (b == lr || (a < li && pi[a] < pr[b]))
+        sge->tmp[l++] = pi[a++];
+      else if (a == li || pr[b] < pi[a]) {
+        int j = pr[b++];
+        sge->tmp[l++] = j, sge->wt[j]++;
+        sge_push(&sge->col[j], &sge->clen[j], &sge->ccap[j], i); }
+      else
+        sge->wt[pi[a]]--, a++, b++; }
+    if (l > sge->cap[i]) {
+      sge->row[i] = realloc(sge->row[i], (sge->cap[i] = l) * sizeof(int));
+      assert(sge->row[i]); }
+    memcpy(sge->row[i], sge->tmp, l * sizeof(int));
+    sge->len[i] = l; }
+
+  // drop row r and column c
+  for (int j = 0; j < lr; j++)
+    sge->wt[pr[j]]--;
+  sge->len[r] = -1;
+  sge->clen[c] = 0;
+  assert(sge->wt[c] == 0);
+  sge->wt[c] = -1; }
+
+
+int gf2_sge_reduce(gf2_sge_t *sge) {
+
+  // returns number of columns left for the dense core
+
+  const int m = sge->m, n = sge->n, maxlen = sge->maxlen;
+
+  // raise the weight threshold gradually so the lightest columns go
+  // first and fill-in stays low
+  for (int maxw = 1; maxw <= sge->maxw; maxw++)
+    for (int changed = 1; changed;) {
+      changed = 0;
+
+      // row singletons and doubletons: no fill for singletons, and
+      // merging the lighter column of a doubleton into the heavier
+      for (int r = 0; r < m; r++) {
+        int l = sge->len[r];
+        if (l == 0) sge->len[r] = -1; // empty rows are just dropped
+        if (l <= 0 || l > 2) continue;
+        int c = sge->row[r][0];
+        if (l == 2 && sge->wt[sge->row[r][1]] < sge->wt[c])
+          c = sge->row[r][1];
+        sge_rows(sge, c);
+        sge_eliminate(sge, c, r);
+        changed = 1; }
+
+      // column singletons and light columns
+      for (int c = 0; c < n; c++) {
+        int w = sge->wt[c];
+        if (w <= 0 || w > maxw) continue;
+        int r = sge_rows(sge, c);
+        if (w > 1 && sge->len[r] > maxlen) continue;
+        sge_eliminate(sge, c, r);
+        changed = 1; } }
+
+  int cm = 0, cn = 0;
+  for (int r = 0; r < m; r++) cm += sge->len[r] > 0;
+  for (int c = 0; c < n; c++) cn += sge->wt[c] >= 0;
+  sge->cm = cm, sge->cn = cn;
+  return cn; }
+
+
+void gf2_sge_core(gf2_sge_t *sge, gf2_t *core) {
+
+  // fill in (and init) a dense gf2 system for what is left; the user
+  // may have set core->kmax or core->tablebits beforehand
+
+  const int m = sge->m, n = sge->n;
+  int *map = malloc(n * sizeof *map);
+  sge->core_col = realloc(sge->core_col, (sge->cn + 1) * sizeof(int));
+  assert(map && sge->core_col);
+  int cn = 0;
+  for (int c = 0; c < n; c++)
+    if (sge->wt[c] >= 0)
+      map[c] = cn, sge->core_col[cn++] = c;
+    else
+      map[c] = -1;
+  assert(cn == sge->cn);
+
+  core->m = sge->cm > 0 ? sge->cm : 1; // all zero: a single empty row
+  core->n = cn > 0 ? cn : 1;
+  core->b = 0;
+  gf2_init(core);
+  const int wds = core->wds;
+  uint64_t (*C)[wds] = core->matrix;
+  for (int r = 0, i = 0; r < m; r++) {
+    if (sge->len[r] <= 0) continue;
+    for (int j = 0; j < sge->len[r]; j++) {
+      int c = map[sge->row[r][j]];
+      C[i][c/64] ^= 1UL << (c%64); }
+    i++; }
+  free(map); }
+
+
+int gf2_sge_lift(gf2_sge_t *sge, gf2_t *core, int k, int wds,
+                 uint64_t (*K)[wds]) {
+
+  // lift the first k kernel vectors of the dense core back to the
+  // original columns; returns the number lifted. We do 64 vectors at
+  // a time, one bit each in x[0..n), so each recorded row costs just
+  // one pass over its columns.
+
+  const int n = sge->n, cwds = core->wds;
+  uint64_t (*C)[cwds] = core->kernel;
+  assert(n <= 64 * wds);
+  if (sge->cn == 0) return 0;
+  uint64_t *x = malloc(n * sizeof *x);
+  assert(x);
+
+  for (int i0 = 0; i0 < k; i0 += 64) {
+    int i1 = i0 + 64 < k ? i0 + 64 : k;
+    memset(x, 0, n * sizeof *x);
+    for (int i = i0; i < i1; i++)
+      for (int j = 0; j < sge->cn; j++)
+        if (C[i][j/64] >> (j%64) & 1)
+          x[sge->core_col[j]] |= 1UL << (i - i0);
+    for (int t = sge->nlift - 1; t >= 0; t--) {
+      uint64_t v = 0;
+      for (long l = sge->lstart[t]; l < sge->lstart[t+1]; l++)
+        v ^= x[sge->lcols[l]];
+      x[sge->lcol[t]] = v; }
+    for (int i = i0; i < i1; i++) {
+      for (int w = 0; w < wds; w++) K[i][w] = 0;
+      for (int c = 0; c < n; c++)
+        K[i][c/64] |= (x[c] >> (i - i0) & 1) << (c%64); } }
+
+  free(x);
+  return k; }
+
+
+int gf2_sparse_kernel(const gf2_csr_t *A, int k, int wds,
+                      uint64_t (*K)[wds]) {
+
+  // all in one: reduce, solve the dense core, lift at most k kernel
+  // vectors into K; returns the number found
+
+  gf2_sge_t sge = { 0 };
+  gf2_sge_init(&sge, A);
+  gf2_sge_reduce(&sge);
+  gf2_t core = { .kmax = k };
+  gf2_sge_core(&sge, &core);
+  int r = gf2_kernel(&core);
+  r = gf2_sge_lift(&sge, &core, r, wds, K);
+  gf2_clear(&core);
+  gf2_sge_clear(&sge);
+  return r; }
+
+#endif